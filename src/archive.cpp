@@ -0,0 +1,261 @@
+// Transparent decompression of gzip'd statements and zip bundles. Documents
+// are inflated in fixed-size chunks into a caller-supplied stream, so only
+// one member of a bundle is ever decompressed at a time.
+
+#include <Rcpp.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "archive.h"
+
+using namespace std;
+
+static const size_t CHUNK_SIZE = 64 * 1024;
+
+// Zip record signatures and fixed header sizes (APPNOTE.TXT, section 4.3)
+static const unsigned long ZIP_LOCAL_SIG = 0x04034b50;
+static const unsigned long ZIP_CENTRAL_SIG = 0x02014b50;
+static const unsigned long ZIP_END_SIG = 0x06054b50;
+static const size_t ZIP_LOCAL_LEN = 30;
+static const size_t ZIP_CENTRAL_LEN = 46;
+static const size_t ZIP_END_LEN = 22;
+static const size_t ZIP_MAX_COMMENT = 0xffff;
+
+static unsigned int read_u16(const string& buf, size_t pos)
+{
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(buf.data()) + pos;
+  return p[0] | (p[1] << 8);
+}
+
+static unsigned long read_u32(const string& buf, size_t pos)
+{
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(buf.data()) + pos;
+  return (unsigned long) p[0] | ((unsigned long) p[1] << 8) |
+    ((unsigned long) p[2] << 16) | ((unsigned long) p[3] << 24);
+}
+
+// Reads `len` bytes at `offset`, or fewer if the file ends first.
+static string read_at(ifstream& in, unsigned long offset, size_t len)
+{
+  in.clear();
+  in.seekg(offset);
+  string buf(len, '\0');
+  in.read(&buf[0], len);
+  buf.resize(in.gcount());
+  return buf;
+}
+
+static bool has_statement_extension(const string& name)
+{
+  size_t dot = name.rfind('.');
+  if (dot == string::npos){
+    return false;
+  }
+  string ext = name.substr(dot + 1);
+  transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  return ext == "ofx" || ext == "qfx";
+}
+
+ArchiveFormat detect_archive_format(const string& filename)
+{
+  ifstream in(filename.c_str(), ios::binary);
+  if (!in){
+    Rcpp::stop("Unable to open file: " + filename);
+  }
+
+  unsigned char magic[4] = {0, 0, 0, 0};
+  in.read(reinterpret_cast<char*>(magic), sizeof(magic));
+  streamsize n = in.gcount();
+
+  if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+    return ARCHIVE_GZIP;
+  if (n >= 4 && magic[0] == 'P' && magic[1] == 'K' && magic[2] == 0x03 && magic[3] == 0x04)
+    return ARCHIVE_ZIP;
+  return ARCHIVE_NONE;
+}
+
+void inflate_gzip_file(const string& filename, ostream& out)
+{
+  gzFile gz = gzopen(filename.c_str(), "rb");
+  if (gz == NULL){
+    Rcpp::stop("Unable to open gzip file: " + filename);
+  }
+  gzbuffer(gz, CHUNK_SIZE);
+
+  vector<char> chunk(CHUNK_SIZE);
+  int n;
+  while ((n = gzread(gz, &chunk[0], chunk.size())) > 0){
+    out.write(&chunk[0], n);
+  }
+
+  // A truncated stream just reads as EOF; only gzerror reports it
+  int errnum = Z_OK;
+  string msg = gzerror(gz, &errnum);
+  gzclose(gz);
+  if (n < 0 || errnum != Z_OK){
+    Rcpp::stop("Error decompressing " + filename + ": " + msg);
+  }
+}
+
+vector<ZipMember> list_zip_members(const string& filename)
+{
+  ifstream in(filename.c_str(), ios::binary);
+  if (!in){
+    Rcpp::stop("Unable to open zip file: " + filename);
+  }
+  in.seekg(0, ios::end);
+  unsigned long size = in.tellg();
+
+  // The end of central directory record sits at the very end of the file,
+  // followed only by an optional comment of up to 64KB.
+  if (size < ZIP_END_LEN){
+    Rcpp::stop("Invalid zip file: " + filename);
+  }
+  unsigned long tail_offset = size > ZIP_END_LEN + ZIP_MAX_COMMENT ?
+    size - ZIP_END_LEN - ZIP_MAX_COMMENT : 0;
+  string tail = read_at(in, tail_offset, size - tail_offset);
+
+  size_t end = string::npos;
+  for (size_t pos = tail.size() - ZIP_END_LEN + 1; pos-- > 0; ){
+    if (read_u32(tail, pos) == ZIP_END_SIG){
+      end = pos;
+      break;
+    }
+  }
+  if (end == string::npos){
+    Rcpp::stop("Invalid zip file (no central directory): " + filename);
+  }
+
+  unsigned int entries = read_u16(tail, end + 10);
+  unsigned long cd_size = read_u32(tail, end + 12);
+  unsigned long cd_offset = read_u32(tail, end + 16);
+  if (entries == 0xffff || cd_offset == 0xffffffffUL){
+    Rcpp::stop("Zip64 archives are not currently supported");
+  }
+  if (cd_offset + cd_size > size){
+    Rcpp::stop("Corrupt zip central directory: " + filename);
+  }
+  string cd = read_at(in, cd_offset, cd_size);
+
+  vector<ZipMember> members;
+  size_t pos = 0;
+  for (unsigned int i = 0; i < entries; i++){
+    if (pos + ZIP_CENTRAL_LEN > cd.size() || read_u32(cd, pos) != ZIP_CENTRAL_SIG){
+      Rcpp::stop("Corrupt zip central directory: " + filename);
+    }
+
+    unsigned int flags = read_u16(cd, pos + 8);
+    unsigned int name_len = read_u16(cd, pos + 28);
+    unsigned int extra_len = read_u16(cd, pos + 30);
+    unsigned int comment_len = read_u16(cd, pos + 32);
+    if (pos + ZIP_CENTRAL_LEN + name_len > cd.size()){
+      Rcpp::stop("Corrupt zip central directory: " + filename);
+    }
+
+    ZipMember member;
+    member.name = cd.substr(pos + ZIP_CENTRAL_LEN, name_len);
+    member.method = read_u16(cd, pos + 10);
+    // The CRC and sizes come from the central directory since the local header may defer
+    // them to a trailing data descriptor.
+    member.crc = read_u32(cd, pos + 16);
+    member.compressedSize = read_u32(cd, pos + 20);
+    member.uncompressedSize = read_u32(cd, pos + 24);
+    member.localOffset = read_u32(cd, pos + 42);
+    pos += ZIP_CENTRAL_LEN + name_len + extra_len + comment_len;
+
+    // Skip directories, macOS resource forks and anything that isn't a statement
+    if (!has_statement_extension(member.name) || member.name.compare(0, 9, "__MACOSX/") == 0){
+      continue;
+    }
+    if (flags & 0x1){
+      Rcpp::stop("Encrypted zip members are not supported: " + member.name);
+    }
+    if (member.compressedSize == 0xffffffffUL || member.uncompressedSize == 0xffffffffUL ||
+        member.localOffset == 0xffffffffUL){
+      Rcpp::stop("Zip64 archives are not currently supported");
+    }
+    if (member.method != 0 && member.method != Z_DEFLATED){
+      Rcpp::stop("Unsupported zip compression method for member: " + member.name);
+    }
+    members.push_back(member);
+  }
+
+  return members;
+}
+
+void inflate_zip_member(const string& filename, const ZipMember& member, ostream& out)
+{
+  ifstream in(filename.c_str(), ios::binary);
+  if (!in){
+    Rcpp::stop("Unable to open zip file: " + filename);
+  }
+
+  string local = read_at(in, member.localOffset, ZIP_LOCAL_LEN);
+  if (local.size() < ZIP_LOCAL_LEN || read_u32(local, 0) != ZIP_LOCAL_SIG){
+    Rcpp::stop("Corrupt zip member: " + member.name);
+  }
+  in.clear();
+  in.seekg(member.localOffset + ZIP_LOCAL_LEN + read_u16(local, 26) + read_u16(local, 28));
+
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  if (member.method == Z_DEFLATED && inflateInit2(&strm, -MAX_WBITS) != Z_OK){
+    Rcpp::stop("Unable to initialize zlib");
+  }
+
+  vector<char> in_chunk(CHUNK_SIZE);
+  vector<char> out_chunk(CHUNK_SIZE);
+  unsigned long remaining = member.compressedSize;
+  unsigned long crc = crc32(0L, Z_NULL, 0);
+  unsigned long written = 0;
+  int ret = Z_OK;
+
+  while (remaining > 0 && ret != Z_STREAM_END){
+    in.read(&in_chunk[0], min<unsigned long>(remaining, in_chunk.size()));
+    size_t n = in.gcount();
+    if (n == 0){
+      break;
+    }
+    remaining -= n;
+
+    if (member.method == 0){
+      out.write(&in_chunk[0], n);
+      crc = crc32(crc, reinterpret_cast<Bytef*>(&in_chunk[0]), n);
+      written += n;
+      continue;
+    }
+
+    strm.next_in = reinterpret_cast<Bytef*>(&in_chunk[0]);
+    strm.avail_in = n;
+    do {
+      strm.next_out = reinterpret_cast<Bytef*>(&out_chunk[0]);
+      strm.avail_out = out_chunk.size();
+      ret = inflate(&strm, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR){
+        inflateEnd(&strm);
+        Rcpp::stop("Corrupt zip member: " + member.name);
+      }
+      size_t produced = out_chunk.size() - strm.avail_out;
+      out.write(&out_chunk[0], produced);
+      crc = crc32(crc, reinterpret_cast<Bytef*>(&out_chunk[0]), produced);
+      written += produced;
+    } while (ret != Z_STREAM_END && strm.avail_out == 0);
+  }
+
+  bool complete = member.method == 0 ? remaining == 0 : ret == Z_STREAM_END;
+  if (member.method == Z_DEFLATED){
+    inflateEnd(&strm);
+  }
+  if (!complete){
+    Rcpp::stop("Truncated zip member: " + member.name);
+  }
+  if (crc != member.crc || written != member.uncompressedSize){
+    Rcpp::stop("Corrupt zip member: " + member.name);
+  }
+}
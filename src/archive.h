@@ -0,0 +1,41 @@
+#ifndef ROFX_ARCHIVE_H
+#define ROFX_ARCHIVE_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// How the bytes of a statement file are packaged on disk, as determined by
+// the file's leading magic bytes rather than its extension.
+enum ArchiveFormat {
+  ARCHIVE_NONE,
+  ARCHIVE_GZIP,
+  ARCHIVE_ZIP
+};
+
+// Where a single OFX/QFX document lives inside a zip bundle, as recorded in
+// the archive's central directory.
+struct ZipMember {
+  std::string name;
+  unsigned long crc;
+  unsigned long localOffset;
+  unsigned long compressedSize;
+  unsigned long uncompressedSize;
+  unsigned int method;
+};
+
+ArchiveFormat detect_archive_format(const std::string& filename);
+
+// Inflates a (possibly multi-member) gzip file into `out` chunk by chunk.
+void inflate_gzip_file(const std::string& filename, std::ostream& out);
+
+// Lists the .ofx/.qfx members of a zip file, in central directory order,
+// without decompressing any of them.
+std::vector<ZipMember> list_zip_members(const std::string& filename);
+
+// Inflates a single zip member into `out` chunk by chunk, checking it against
+// the CRC-32 and size recorded in the central directory.
+void inflate_zip_member(const std::string& filename, const ZipMember& member,
+                        std::ostream& out);
+
+#endif
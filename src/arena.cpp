@@ -0,0 +1,222 @@
+// Lazy ALTREP character vectors backed by a per-parse StringArena.
+
+#include <Rcpp.h>
+
+#include <cstring>
+#include <utility>
+
+#include <R_ext/Altrep.h>
+
+#include "arena.h"
+
+using namespace std;
+
+StringArena::StringArena() : index(16, KeyHash{&bytes}, KeyEqual{&bytes}) {
+}
+
+size_t StringArena::KeyHash::operator()(const Key& key) const
+{
+  // FNV-1a
+  size_t hash = 2166136261u;
+  const char* p = bytes->data() + key.offset;
+  for (size_t i = 0; i < key.len; i++){
+    hash = (hash ^ (unsigned char) p[i]) * 16777619u;
+  }
+  return hash;
+}
+
+bool StringArena::KeyEqual::operator()(const Key& a, const Key& b) const
+{
+  return a.len == b.len &&
+    memcmp(bytes->data() + a.offset, bytes->data() + b.offset, a.len) == 0;
+}
+
+size_t StringArena::intern(const char* s, size_t len)
+{
+  // Append first so the candidate can be looked up in place, then roll back
+  // if an identical value is already stored.
+  size_t offset = bytes.size();
+  bytes.append(s, len);
+  Key key = {offset, len};
+
+  unordered_set<Key, KeyHash, KeyEqual>::const_iterator found = index.find(key);
+  if (found != index.end()){
+    bytes.resize(offset);
+    return found->offset;
+  }
+  index.insert(key);
+  return offset;
+}
+
+void StringArena::seal()
+{
+  unordered_set<Key, KeyHash, KeyEqual>(0, KeyHash{&bytes}, KeyEqual{&bytes}).swap(index);
+  bytes.shrink_to_fit();
+}
+
+ArenaColumn::ArenaColumn(shared_ptr<StringArena> arena) : arena(arena),
+  naCount(0) {
+}
+
+void ArenaColumn::push_back(const char* s)
+{
+  size_t len = strlen(s);
+  offsets.push_back(arena->intern(s, len));
+  lengths.push_back(len);
+}
+
+void ArenaColumn::push_back_na()
+{
+  offsets.push_back(0);
+  lengths.push_back(-1);
+  naCount++;
+}
+
+SEXP ArenaColumn::elt(R_xlen_t i) const
+{
+  if (lengths[i] < 0){
+    return NA_STRING;
+  }
+  return Rf_mkCharLenCE(arena->data() + offsets[i], lengths[i], CE_NATIVE);
+}
+
+/*
+ * data1 is an external pointer to the ArenaColumn; it is cleared once the
+ * vector has been expanded so the arena can be freed. data2 holds the
+ * expanded STRSXP, or NULL until then. No serialization hooks are
+ * registered, so saved vectors are written as plain character vectors and
+ * can be read back without rofx.
+ */
+
+static R_altrep_class_t arena_string_class;
+
+static void release_column(SEXP ptr)
+{
+  ArenaColumn* column = static_cast<ArenaColumn*>(R_ExternalPtrAddr(ptr));
+  if (column != NULL){
+    delete column;
+    R_ClearExternalPtr(ptr);
+  }
+}
+
+static ArenaColumn* arena_column(SEXP x)
+{
+  return static_cast<ArenaColumn*>(R_ExternalPtrAddr(R_altrep_data1(x)));
+}
+
+// Takes ownership of `column`
+static SEXP wrap_column(ArenaColumn* column)
+{
+  SEXP ptr = PROTECT(R_MakeExternalPtr(column, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(ptr, release_column, TRUE);
+
+  SEXP out = R_new_altrep(arena_string_class, ptr, R_NilValue);
+  UNPROTECT(1);
+  return out;
+}
+
+static bool is_expanded(SEXP x)
+{
+  return R_altrep_data2(x) != R_NilValue;
+}
+
+static SEXP expand(SEXP x)
+{
+  if (is_expanded(x)){
+    return R_altrep_data2(x);
+  }
+
+  ArenaColumn* column = arena_column(x);
+  R_xlen_t n = column->size();
+  SEXP out = PROTECT(Rf_allocVector(STRSXP, n));
+  for (R_xlen_t i = 0; i < n; i++){
+    SET_STRING_ELT(out, i, column->elt(i));
+  }
+  R_set_altrep_data2(x, out);
+  UNPROTECT(1);
+
+  release_column(R_altrep_data1(x));
+  return out;
+}
+
+static R_xlen_t arena_string_length(SEXP x)
+{
+  if (is_expanded(x)){
+    return XLENGTH(R_altrep_data2(x));
+  }
+  return arena_column(x)->size();
+}
+
+static Rboolean arena_string_inspect(SEXP x, int pre, int deep, int pvec,
+                                     void (*inspect_subtree)(SEXP, int, int, int))
+{
+  Rprintf("arena_string (len=%lld, expanded=%s)\n",
+          (long long) arena_string_length(x), is_expanded(x) ? "TRUE" : "FALSE");
+  return TRUE;
+}
+
+static void* arena_string_dataptr(SEXP x, Rboolean writeable)
+{
+  return DATAPTR(expand(x));
+}
+
+static const void* arena_string_dataptr_or_null(SEXP x)
+{
+  if (!is_expanded(x)){
+    return NULL;
+  }
+  return DATAPTR(R_altrep_data2(x));
+}
+
+static SEXP arena_string_elt(SEXP x, R_xlen_t i)
+{
+  if (is_expanded(x)){
+    return STRING_ELT(R_altrep_data2(x), i);
+  }
+  return arena_column(x)->elt(i);
+}
+
+static void arena_string_set_elt(SEXP x, R_xlen_t i, SEXP v)
+{
+  SET_STRING_ELT(expand(x), i, v);
+}
+
+// Copies of a lazy vector stay lazy and share the arena, so `[<-` on a
+// shared column only expands the copy being written to.
+static SEXP arena_string_duplicate(SEXP x, Rboolean deep)
+{
+  if (is_expanded(x)){
+    return Rf_duplicate(R_altrep_data2(x));
+  }
+  return wrap_column(new ArenaColumn(*arena_column(x)));
+}
+
+static int arena_string_no_na(SEXP x)
+{
+  if (is_expanded(x)){
+    return 0;
+  }
+  return arena_column(x)->hasNA() ? 0 : 1;
+}
+
+Rcpp::RObject make_arena_string(ArenaColumn& column)
+{
+  return wrap_column(new ArenaColumn(std::move(column)));
+}
+
+// [[Rcpp::init]]
+void init_arena_string(DllInfo* dll)
+{
+  arena_string_class = R_make_altstring_class("arena_string", "rofx", dll);
+
+  R_set_altrep_Length_method(arena_string_class, arena_string_length);
+  R_set_altrep_Inspect_method(arena_string_class, arena_string_inspect);
+  R_set_altrep_Duplicate_method(arena_string_class, arena_string_duplicate);
+
+  R_set_altvec_Dataptr_method(arena_string_class, arena_string_dataptr);
+  R_set_altvec_Dataptr_or_null_method(arena_string_class, arena_string_dataptr_or_null);
+
+  R_set_altstring_Elt_method(arena_string_class, arena_string_elt);
+  R_set_altstring_Set_elt_method(arena_string_class, arena_string_set_elt);
+  R_set_altstring_No_NA_method(arena_string_class, arena_string_no_na);
+}
@@ -0,0 +1,71 @@
+#ifndef ROFX_ARENA_H
+#define ROFX_ARENA_H
+
+#include <Rcpp.h>
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Backing store for the free-text columns of a single parse. Each distinct
+// value is stored once in a contiguous buffer and addressed by its offset,
+// so repeated payees and names share their bytes.
+class StringArena {
+public:
+  StringArena();
+
+  size_t intern(const char* s, size_t len);
+  const char* data() const { return bytes.data(); }
+
+  // Drops the lookup index once parsing is done and no values will be added.
+  void seal();
+
+private:
+  struct Key {
+    size_t offset;
+    size_t len;
+  };
+  struct KeyHash {
+    const std::string* bytes;
+    size_t operator()(const Key& key) const;
+  };
+  struct KeyEqual {
+    const std::string* bytes;
+    bool operator()(const Key& a, const Key& b) const;
+  };
+
+  std::string bytes;
+  std::unordered_set<Key, KeyHash, KeyEqual> index;
+
+  // The index refers back to `bytes`, so an arena can't be copied
+  StringArena(const StringArena&);
+  StringArena& operator=(const StringArena&);
+};
+
+// A character column whose values live in a shared StringArena. Values are
+// only turned into CHARSXPs once R asks for them.
+class ArenaColumn {
+public:
+  explicit ArenaColumn(std::shared_ptr<StringArena> arena);
+
+  void push_back(const char* s);
+  void push_back_na();
+
+  R_xlen_t size() const { return offsets.size(); }
+  bool hasNA() const { return naCount > 0; }
+  SEXP elt(R_xlen_t i) const;
+
+private:
+  std::shared_ptr<StringArena> arena;
+  std::vector<size_t> offsets;
+  std::vector<int> lengths; // -1 marks NA
+  R_xlen_t naCount;
+};
+
+// Hands the column's values over to a lazy ALTREP character vector, leaving
+// `column` empty. The vector expands fully the first time R needs a data
+// pointer or one of its elements is modified.
+Rcpp::RObject make_arena_string(ArenaColumn& column);
+
+#endif
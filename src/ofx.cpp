@@ -41,8 +41,12 @@
 #include <iomanip>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <string>
+#include <vector>
 #include "libofx/libofx.h"
+#include "archive.h"
+#include "arena.h"
 #include <stdio.h>		/* for printf() */
 #ifdef HAVE_CONFIG_H
 // #include <config.h>		/* Include config constants, e.g., VERSION TF */
@@ -54,6 +58,9 @@ using namespace std;
 
 class TransactionList {
 public:
+  // Shared by the free-text columns below, which are read back lazily
+  std::shared_ptr<StringArena> arena;
+  
   Rcpp::StringVector accountId;
   Rcpp::StringVector transactionType;
   Rcpp::DatetimeVector initiated;
@@ -73,24 +80,25 @@ public:
   Rcpp::StringVector unique_id;
   Rcpp::StringVector unique_id_type;
   Rcpp::StringVector server_transaction_id;
-  Rcpp::StringVector check_number;
-  Rcpp::StringVector reference_number;
+  ArenaColumn check_number;
+  ArenaColumn reference_number;
   Rcpp::NumericVector standard_industrial_code;
-  Rcpp::StringVector payee_id;
-  Rcpp::StringVector name;
-  Rcpp::StringVector memo;
+  ArenaColumn payee_id;
+  ArenaColumn name;
+  ArenaColumn memo;
   
   Rcpp::DataFrame toList();
   TransactionList(); // constructor
 };
 
-TransactionList::TransactionList(void) : accountId(0), transactionType(0), 
+TransactionList::TransactionList(void) : arena(std::make_shared<StringArena>()),
+  accountId(0), transactionType(0), 
   initiated(0), posted(0), fundsAvailable(0), amount(0), units(0), oldUnits(0),
   newUnits(0), unitprice(0), fees(0), commission(0), fi_id(0), 
   fi_id_corrected(0), fi_id_correction_action(0), invTransactionType(0), 
-  unique_id(0), unique_id_type(0), server_transaction_id(0), check_number(0), 
-  reference_number(0), standard_industrial_code(0), payee_id(0), name(0), 
-  memo(0) {
+  unique_id(0), unique_id_type(0), server_transaction_id(0), check_number(arena), 
+  reference_number(arena), standard_industrial_code(0), payee_id(arena), 
+  name(arena), memo(arena) {
 }
 
 Rcpp::DataFrame TransactionList::toList(){
@@ -114,12 +122,13 @@ Rcpp::DataFrame TransactionList::toList(){
   r.push_back(unique_id, "unique_id");
   r.push_back(unique_id_type, "unique_id_type");
   r.push_back(server_transaction_id, "server_transaction_id");
-  r.push_back(check_number, "check_number");
-  r.push_back(reference_number, "reference_number");
+  arena->seal();
+  r.push_back(make_arena_string(check_number), "check_number");
+  r.push_back(make_arena_string(reference_number), "reference_number");
   r.push_back(standard_industrial_code, "standard_industrial_code");
-  r.push_back(payee_id, "payee_id");
-  r.push_back(name, "name");
-  r.push_back(memo, "memo");
+  r.push_back(make_arena_string(payee_id), "payee_id");
+  r.push_back(make_arena_string(name), "name");
+  r.push_back(make_arena_string(memo), "memo");
   
   return r;
   
@@ -361,14 +370,14 @@ int ofx_proc_transaction_cb(struct OfxTransactionData data, void * transaction_d
   {
     tl->check_number.push_back(data.check_number);
   } else {
-    tl->check_number.push_back(NA_STRING);
+    tl->check_number.push_back_na();
   }
   
   if (data.reference_number_valid == true)
   {
     tl->reference_number.push_back(data.reference_number);
   } else {
-    tl->reference_number.push_back(NA_STRING);
+    tl->reference_number.push_back_na();
   }
   
   if (data.standard_industrial_code_valid == true)
@@ -382,21 +391,21 @@ int ofx_proc_transaction_cb(struct OfxTransactionData data, void * transaction_d
   {
     tl->payee_id.push_back(data.payee_id);
   } else {
-    tl->payee_id.push_back(NA_STRING);
+    tl->payee_id.push_back_na();
   }
   
   if (data.name_valid == true)
   {
     tl->name.push_back(data.name);
   } else {
-    tl->name.push_back(NA_STRING);
+    tl->name.push_back_na();
   }
   
   if (data.memo_valid == true)
   {
     tl->memo.push_back(data.memo);
   } else {
-    tl->memo.push_back(NA_STRING);
+    tl->memo.push_back_na();
   }
   
   return 0;
@@ -623,13 +632,61 @@ int ofx_proc_status_cb(struct OfxStatusData data, void * status_data)
   return 0;
 }
 
-// [[Rcpp::export]]
-SEXP ofx_info(SEXP path)
+// Owns a libofx context so it is freed however parsing ends, including when a
+// callback bails out with Rcpp::stop.
+class LibofxContext {
+public:
+  LibofxContextPtr ptr;
+  
+  LibofxContext() : ptr(libofx_get_new_context()) {}
+  ~LibofxContext() { libofx_free_context(ptr); }
+  
+private:
+  LibofxContext(const LibofxContext&);
+  LibofxContext& operator=(const LibofxContext&);
+};
+
+// A scratch file holding one decompressed document, removed once parsed.
+// libofx only does its header, CHARSET, DTD version and QFX tag handling in
+// libofx_proc_file, so decompressed input goes through a file on disk too
+// rather than libofx_proc_buffer (which skips all of it).
+class SpoolFile {
+public:
+  string path;
+  ofstream out;
+  
+  SpoolFile() {
+    Rcpp::Function tempfile("tempfile");
+    path = Rcpp::as<string>(tempfile(Rcpp::Named("pattern") = "rofx",
+                                     Rcpp::Named("fileext") = ".ofx"));
+    out.open(path.c_str(), ios::binary);
+    if (!out){
+      Rcpp::stop("Unable to create temporary file: " + path);
+    }
+  }
+  ~SpoolFile() {
+    out.close();
+    remove(path.c_str());
+  }
+  
+  void finish() {
+    out.close();
+    if (out.fail()){
+      Rcpp::stop("Unable to write temporary file: " + path);
+    }
+  }
+  
+private:
+  SpoolFile(const SpoolFile&);
+  SpoolFile& operator=(const SpoolFile&);
+};
+
+// Runs libofx over the single document at `filename`.
+Rcpp::List parse_ofx(const string& filename)
 {
   Rcpp::List inf = Rcpp::List::create();
-  LibofxContextPtr libofx_context = libofx_get_new_context();
-  
-  string filename = Rcpp::as<string>(path);
+  LibofxContext context;
+  LibofxContextPtr libofx_context = context.ptr;
   
   TransactionList tl = TransactionList();
   
@@ -640,7 +697,6 @@ SEXP ofx_info(SEXP path)
   ofx_set_status_cb(libofx_context, ofx_proc_status_cb, &inf);
   
   enum LibofxFileFormat file_format = libofx_get_file_format_from_str(LibofxImportFormatList, "AUTODETECT");
-
   libofx_proc_file(libofx_context, filename.c_str(), file_format);
   
   // Bring the accumulated transactions onto the list
@@ -648,3 +704,44 @@ SEXP ofx_info(SEXP path)
   
   return inf;
 }
+
+// [[Rcpp::export]]
+SEXP ofx_info(SEXP path)
+{
+  string filename = Rcpp::as<string>(path);
+  
+  switch (detect_archive_format(filename))
+  {
+  case ARCHIVE_GZIP :
+  {
+    SpoolFile spool;
+    inflate_gzip_file(filename, spool.out);
+    spool.finish();
+    return parse_ofx(spool.path);
+  }
+  case ARCHIVE_ZIP :
+  {
+    vector<ZipMember> members = list_zip_members(filename);
+    if (members.empty()){
+      Rcpp::stop("No OFX/QFX files found in zip archive: " + filename);
+    }
+    
+    // One result per statement in the bundle, named by the member's path.
+    // Members are inflated and parsed one at a time.
+    Rcpp::List results(members.size());
+    Rcpp::CharacterVector names(members.size());
+    for (size_t i = 0; i < members.size(); i++){
+      SpoolFile spool;
+      inflate_zip_member(filename, members[i], spool.out);
+      spool.finish();
+      results[i] = parse_ofx(spool.path);
+      names[i] = members[i].name;
+    }
+    results.attr("names") = names;
+    results.attr("archive") = true;
+    return results;
+  }
+  default:
+    return parse_ofx(filename);
+  }
+}